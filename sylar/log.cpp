@@ -1,6 +1,12 @@
 #include "log.h"
 #include <iostream>
 #include <iomanip>
+#include <chrono>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <map>
+#include <sys/stat.h>
 
 namespace sylar {
 
@@ -91,15 +97,217 @@ namespace sylar {
         log(LogLevel::FATAL, event);
     }
 
+    // 析构时等待日志写出的最长时间
+    static const int kExitFlushTimeoutMs = 100;
+
+    // sink 表: 按打开的文件 (st_dev, st_ino) 索引, 2>&1 或 dup 出来的 fd 共用同一个 sink,
+    // 避免两个 sink 各自保存/恢复同一文件描述的 O_NONBLOCK
+    struct SinkRegistry
+    {
+        struct Entry
+        {
+            FdLogSink* sink = nullptr;
+            size_t refs = 0;            // 引用计数, 在 mutex 下增减
+        };
+        std::mutex mutex;
+        std::map<std::pair<uint64_t, uint64_t>, Entry> sinks;
+    };
+
+    // 故意泄漏, 保证任何静态 Logger/appender 析构时注册表仍然有效
+    static SinkRegistry& GetSinkRegistry()
+    {
+        static SinkRegistry* s_registry = new SinkRegistry;
+        return *s_registry;
+    }
+
+    static std::pair<uint64_t, uint64_t> GetSinkKey(int fd)
+    {
+        struct stat st;
+        if (::fstat(fd, &st) == 0)
+        {
+            return { static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino) };
+        }
+        return { UINT64_MAX, static_cast<uint64_t>(fd) }; // fstat 失败时退化为按 fd 区分
+    }
+
+    FdLogSinkPtr FdLogSink::get(int fd, size_t maxBufferSize)
+    {
+        auto& registry = GetSinkRegistry();
+        auto key = GetSinkKey(fd);
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        auto& entry = registry.sinks[key];
+        if (!entry.sink)
+        {
+            // 缓冲区上限只在创建时设置, 后来的 appender 不会覆盖已有配置
+            entry.sink = new FdLogSink(fd);
+            entry.sink->setMaxBufferSize(maxBufferSize);
+        }
+        ++entry.refs;
+        // 每次 get 返回独立的 shared_ptr, 释放时在表锁下递减计数,
+        // 计数归零才析构 sink, 保证恢复标志和新 sink 设置标志不会交错
+        return FdLogSinkPtr(entry.sink, [key](FdLogSink* p) {
+            auto& registry = GetSinkRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            auto it = registry.sinks.find(key);
+            if (it != registry.sinks.end() && --it->second.refs == 0)
+            {
+                registry.sinks.erase(it);
+                delete p;
+            }
+        });
+    }
+
+    FdLogSink::FdLogSink(int fd)
+        : m_fd(fd)
+    {
+        m_oldFlags = ::fcntl(m_fd, F_GETFL);
+        if (m_oldFlags != -1 && !(m_oldFlags & O_NONBLOCK))
+        {
+            ::fcntl(m_fd, F_SETFL, m_oldFlags | O_NONBLOCK);
+        }
+    }
+
+    FdLogSink::~FdLogSink()
+    {
+        // 各 appender 析构时已经限时写过, 这里只做最后一次非阻塞尝试
+        flush(0);
+        m_droppedBytes += m_buffer.size();
+        m_buffer.clear();
+        if (m_oldFlags != -1 && !(m_oldFlags & O_NONBLOCK))
+        {
+            ::fcntl(m_fd, F_SETFL, m_oldFlags);
+        }
+    }
+
+    bool FdLogSink::append(const std::string& line, int blockTimeoutMs)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(blockTimeoutMs);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // 空缓冲区总能放下一条, 防止超长的单条日志永远写不出去
+        while (!m_buffer.empty() && m_buffer.size() + line.size() > m_maxBufferSize)
+        {
+            tryWrite();
+            if (m_buffer.empty() || m_buffer.size() + line.size() <= m_maxBufferSize)
+            {
+                break;
+            }
+            int waitMs = -1;
+            if (blockTimeoutMs >= 0)
+            {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+                if (left <= 0) // 不阻塞或等待超时, 丢弃本条
+                {
+                    m_droppedBytes += line.size();
+                    return false;
+                }
+                waitMs = static_cast<int>(left);
+            }
+            waitWritable(lock, waitMs);
+        }
+        // 追加后只 write 一次, 积压时多条日志合并为一次写; 畅通时仍是每条一次 write
+        m_buffer.append(line);
+        return tryWrite();
+    }
+
+    bool FdLogSink::flush(int timeoutMs)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_buffer.empty())
+        {
+            if (!tryWrite())
+            {
+                return false;
+            }
+            if (m_buffer.empty())
+            {
+                break;
+            }
+            int waitMs = -1;
+            if (timeoutMs >= 0)
+            {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+                if (left <= 0)
+                {
+                    return false;
+                }
+                waitMs = static_cast<int>(left);
+            }
+            waitWritable(lock, waitMs);
+        }
+        return true;
+    }
+
+    // 调用方需持有 m_mutex
+    bool FdLogSink::tryWrite()
+    {
+        size_t written = 0;
+        bool ok = true;
+        while (written < m_buffer.size())
+        {
+            ssize_t n = ::write(m_fd, m_buffer.data() + written, m_buffer.size() - written);
+            if (n > 0)
+            {
+                written += n;
+            }
+            else if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break; // 管道满了, 剩下的留到下次
+            }
+            else
+            {
+                // fd 已失效, 丢弃积压数据防止无限增长
+                ok = false;
+                m_droppedBytes += m_buffer.size() - written;
+                written = m_buffer.size();
+            }
+        }
+        m_buffer.erase(0, written);
+        return ok;
+    }
+
+    void FdLogSink::waitWritable(std::unique_lock<std::mutex>& lock, int timeoutMs)
+    {
+        auto start = std::chrono::steady_clock::now();
+        // 等待期间释放锁, 其他线程的低级别日志可以继续追加或丢弃, 而不是排队等锁
+        lock.unlock();
+        struct pollfd pfd = { m_fd, POLLOUT, 0 };
+        while (::poll(&pfd, 1, timeoutMs) < 0 && errno == EINTR) {}
+        lock.lock();
+        m_blockedUs += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    StdoutLogAppender::StdoutLogAppender(int fd, size_t maxBufferSize
+        , OverflowPolicy policy, int blockTimeoutMs)
+        : m_sink(FdLogSink::get(fd, maxBufferSize)), m_policy(policy)
+        , m_blockTimeoutMs(blockTimeoutMs)
+    {
+    }
+
+    StdoutLogAppender::~StdoutLogAppender()
+    {
+        // 退出前限时写出残留日志, DROP 策略不等待
+        m_sink->flush(m_policy == OverflowPolicy::DROP ? 0 : kExitFlushTimeoutMs);
+    }
+
     // formatter可能为空
     void StdoutLogAppender::log(LogLevel level, LogEventPtr event)
     {
-        if (m_formatter) { // 添加空指针检查
-            std::cout << m_formatter->format(event);
-        }
-        else {
-            std::cout << event->getContent() << std::endl; // 默认输出
+        if (level < m_level)
+        {
+            return;
         }
+        // 在锁外格式化, 缩短临界区
+        std::string line = m_formatter ? m_formatter->format(event) : event->getContent() + "\n";
+        bool block = m_policy == OverflowPolicy::BLOCK_ERROR && level >= LogLevel::ERROR;
+        m_sink->append(line, block ? m_blockTimeoutMs.load() : 0);
     }
 
     FileLogAppender::FileLogAppender(const std::string& filename)
@@ -316,7 +524,7 @@ namespace sylar {
 
     void NewLineFormatItem::format(std::ostream& os, LogEventPtr event)
     {
-        os << std::endl;
+        os << '\n'; // 不用 std::endl, 刷新由各 appender 自行决定
     }
 
     void FileFormatItem::format(std::ostream& os, LogEventPtr event)
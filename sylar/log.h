@@ -6,6 +6,9 @@
 #include <fstream>
 #include <list>
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <unistd.h>
 
 namespace sylar
 {
@@ -18,6 +21,7 @@ namespace sylar
     class LogAppender;
     class FileLogAppender;
     class StdoutLogAppender;
+    class FdLogSink;
     class FormatItem;
 
 
@@ -27,6 +31,7 @@ namespace sylar
     using LogAppenderPtr = std::shared_ptr<LogAppender>;
     using FileLogAppenderPtr = std::shared_ptr<FileLogAppender>;
     using StdoutLogAppenderPtr = std::shared_ptr<StdoutLogAppender>;
+    using FdLogSinkPtr = std::shared_ptr<FdLogSink>;
     using FormatItemPtr = std::shared_ptr<FormatItem>;
 
     enum class LogLevel
@@ -140,11 +145,85 @@ namespace sylar
     };
 
 
+    // 缓冲区满时的处理策略
+    enum class OverflowPolicy
+    {
+        DROP = 0,           // 直接丢弃新日志, 永不阻塞
+        BLOCK_ERROR = 1     // 低于 ERROR 的丢弃, ERROR 及以上限时阻塞等待可写
+    };
+
+    // 某个打开文件的共享写出端, 指向同一文件 (包括 dup/2>&1) 的所有 appender 共用一个缓冲区和一把锁,
+    // 保证部分写入时剩余数据先于其他 appender 的日志写出, 不会交错
+    // 第一个使用者设置 O_NONBLOCK, 最后一个使用者释放时恢复原标志
+    class FdLogSink
+    {
+    public:
+        // 按 fd 所指的文件获取, 不存在则以 maxBufferSize 为上限创建
+        static FdLogSinkPtr get(int fd, size_t maxBufferSize = 4 * 1024 * 1024);
+        ~FdLogSink();
+
+        // 追加一条日志并尝试写出; 缓冲区满时最多等待 blockTimeoutMs 毫秒 (0 不等, -1 一直等),
+        // 仍放不下则丢弃, 日志被丢弃返回 false
+        bool append(const std::string& line, int blockTimeoutMs);
+
+        // 最多等待 timeoutMs 毫秒把缓冲区写完, 写完返回 true; 剩余数据留在缓冲区
+        bool flush(int timeoutMs);
+
+        int getFd() const { return m_fd; }
+        size_t getMaxBufferSize() const { return m_maxBufferSize; }
+        void setMaxBufferSize(size_t val) { m_maxBufferSize = val; }
+
+        uint64_t getBlockedUs() const { return m_blockedUs; }          // 累计阻塞时间(微秒)
+        uint64_t getDroppedBytes() const { return m_droppedBytes; }    // 累计丢弃字节数
+    private:
+        FdLogSink(int fd);
+        bool tryWrite();                    // 非阻塞写出缓冲区, fd 出错时丢弃积压并返回 false
+        void waitWritable(std::unique_lock<std::mutex>& lock, int timeoutMs);  // 释放锁等待 fd 可写
+
+        int m_fd;
+        int m_oldFlags = -1;                // 设置 O_NONBLOCK 前的 fd 标志
+        std::mutex m_mutex;
+        std::string m_buffer;               // 待写出的数据
+        std::atomic<size_t> m_maxBufferSize{4 * 1024 * 1024};
+        std::atomic<uint64_t> m_blockedUs{0};
+        std::atomic<uint64_t> m_droppedBytes{0};
+    };
+
     //输出到控制台的Appender
+    // 通过 FdLogSink 以非阻塞方式写 fd (stdout/stderr), 写不出去的内容暂存在有界缓冲区中,
+    // 下次写入时合并成一次大的 write, 避免日志管道堵塞时拖住业务线程
+    // 注意: O_NONBLOCK 作用于整个打开的文件描述, 同一 fd 上再用 std::cout 可能因 EAGAIN 失败
     class StdoutLogAppender : public LogAppender
     {
     public:
+        StdoutLogAppender(int fd = STDOUT_FILENO
+            , size_t maxBufferSize = 4 * 1024 * 1024
+            , OverflowPolicy policy = OverflowPolicy::BLOCK_ERROR
+            , int blockTimeoutMs = 100);
+        ~StdoutLogAppender();
         void log(LogLevel level, LogEventPtr event) override;
+
+        // 最多等待 timeoutMs 毫秒把缓冲区写完, -1 表示一直等
+        bool flush(int timeoutMs = -1) { return m_sink->flush(timeoutMs); }
+
+        OverflowPolicy getPolicy() const { return m_policy; }
+        void setPolicy(OverflowPolicy val) { m_policy = val; }
+
+        // BLOCK_ERROR 下 ERROR 及以上日志最多阻塞的毫秒数, 超时丢弃; -1 表示一直等
+        int getBlockTimeoutMs() const { return m_blockTimeoutMs; }
+        void setBlockTimeoutMs(int val) { m_blockTimeoutMs = val; }
+
+        // 缓冲区按文件共享, maxBufferSize 只在第一个 appender 创建 sink 时生效,
+        // 以下设置和统计对同一文件上的所有 appender 生效
+        size_t getMaxBufferSize() const { return m_sink->getMaxBufferSize(); }
+        void setMaxBufferSize(size_t val) { m_sink->setMaxBufferSize(val); }
+
+        uint64_t getBlockedUs() const { return m_sink->getBlockedUs(); }
+        uint64_t getDroppedBytes() const { return m_sink->getDroppedBytes(); }
+    private:
+        FdLogSinkPtr m_sink;
+        std::atomic<OverflowPolicy> m_policy;
+        std::atomic<int> m_blockTimeoutMs;
     };
 
     //定义输出到文件的Appender